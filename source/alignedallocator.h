@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stddef.h>
+#include <new>
+#include <vector>
+#include <xmmintrin.h>
+
+// std::allocator replacement returning storage aligned for _mm_load_ps/_mm_store_ps.
+// operator new only guarantees 8 bytes on x86-32, so SIMD buffers must not rely on it.
+template <typename T, size_t Align = 16>
+struct aligned_allocator {
+	typedef T value_type;
+
+	template <typename U>
+	struct rebind { typedef aligned_allocator<U, Align> other; };
+
+	aligned_allocator() noexcept {}
+	template <typename U>
+	aligned_allocator(const aligned_allocator<U, Align>&) noexcept {}
+
+	T* allocate(size_t n) {
+		void* p = _mm_malloc(n * sizeof(T), Align);
+		if (!p)
+			throw std::bad_alloc();
+		return static_cast<T*>(p);
+	}
+
+	void deallocate(T* p, size_t) noexcept { _mm_free(p); }
+};
+
+template <typename T, typename U, size_t Align>
+inline bool operator==(const aligned_allocator<T, Align>&, const aligned_allocator<U, Align>&) { return true; }
+template <typename T, typename U, size_t Align>
+inline bool operator!=(const aligned_allocator<T, Align>&, const aligned_allocator<U, Align>&) { return false; }
+
+typedef std::vector<float, aligned_allocator<float>> aligned_vector;
@@ -3,11 +3,22 @@
 #include "public.sdk/source/vst/vstparameters.h"
 
 struct params {
-    float coef_pos;
-    float coef_neg;
+    float coef_pos[2];  // per channel, [1] is R or S (see stereo_mode), mono uses [0]
+    float coef_neg[2];
     int32_t num_stages;
     int32_t invert_stages;
-    float gain;
+    float gain[2];
+    float mix_start;    // dry/wet at the first sample of the block
+    float mix_end;      // dry/wet the block ramps towards
+    int32_t precise;    // accurate curve variants, normalisation evaluated in double
+    int32_t curve;      // DistConst::Curve
+    int32_t stereo_mode;    // DistConst::StereoMode
+};
+
+// processing configuration for one quality level
+struct quality_policy {
+    int32_t oversampling;   // 1 or 2
+    int32_t precise;
 };
 
 namespace Steinberg {
@@ -20,7 +31,15 @@ enum MyDistParams : Vst::ParamID
     kParamInvertStagesID = 104,
     kParamGainID = 105,
 
-    kBypassID = 106
+    kBypassID = 106,
+
+    kParamMixID = 107,
+    kParamQualityID = 108,
+    kParamCurveID = 109,
+    kParamStereoModeID = 110,
+    kParamCoefPos2ID = 111,
+    kParamCoefNeg2ID = 112,
+    kParamGain2ID = 113
 };
 
 namespace DistConst
@@ -34,6 +53,44 @@ namespace DistConst
     static constexpr float GAIN_MIN = 0.0f;
     static constexpr float GAIN_MAX = 1.0f;
     static constexpr float GAIN_DEFAULT = 1.0f;
+    static constexpr float MIX_MIN = 0.0f;
+    static constexpr float MIX_MAX = 1.0f;
+    static constexpr float MIX_DEFAULT = 1.0f;
+    static constexpr float MIX_SMOOTH_TIME = 0.02f;   // seconds
+
+    enum Quality : int32_t {
+        QUALITY_AUTO = 0,       // follows the host process mode
+        QUALITY_REALTIME,
+        QUALITY_OFFLINE,
+
+        QUALITY_COUNT
+    };
+    // cheap and latency free for kRealtime/kPrefetch, full quality for kOffline bounces
+    static constexpr quality_policy QUALITY_POLICY_REALTIME = { 1, 0 };
+    static constexpr quality_policy QUALITY_POLICY_OFFLINE = { 2, 1 };
+    // controller -> processor, sent before kLatencyChanged so the new latency is already reported
+    static constexpr const char* QUALITY_MESSAGE_ID = "Quality";
+    static constexpr const char* QUALITY_MESSAGE_VALUE = "Value";
+
+    // saturation curve families, see curves.h
+    enum Curve : int32_t {
+        CURVE_ATAN = 0,
+        CURVE_TANH,
+        CURVE_CUBIC,
+        CURVE_HARD,
+        CURVE_PADE,
+
+        CURVE_COUNT
+    };
+
+    // what the second coefficient set (kParam*2ID) applies to
+    enum StereoMode : int32_t {
+        STEREO_LINKED = 0,      // unused, both channels take the first set
+        STEREO_DUAL,            // right channel
+        STEREO_MID_SIDE,        // side, the first set shapes mid
+
+        STEREO_COUNT
+    };
 };
 
 }
\ No newline at end of file
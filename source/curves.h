@@ -0,0 +1,179 @@
+#pragma once
+
+#include <stdint.h>
+#include <cmath>
+#include <xmmintrin.h>
+#include <emmintrin.h>
+
+#define PI_4 0.785398163397448309616f  // pi/4
+#define PI_2 1.57079632679489661923f  // pi/2
+
+
+
+typedef union fp32_to_u32 {
+	float f;
+	uint32_t u;
+} fp32_to_u32;
+
+inline float fast_atan(float x) {
+	fp32_to_u32 f2u;
+	f2u.f = x;
+	f2u.u &= 0x7FFFFFFF;
+	return PI_4 * x - x * (f2u.f - 1.0f) * (0.2447f + 0.0663f * f2u.f);
+
+	//const int abs_x_bits = *(uint32_t*)&x & 0x7FFFFFFF;
+	//const float abs_x = *(float*)&abs_x_bits;
+	//return PI_4 * x - x * (abs_x - 1.0f) * (0.2447f + 0.0663f * abs_x);
+}
+
+inline __m128 fast_atan_simd(__m128 x) {
+	const __m128 not_sign_bit = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+	__m128 abs_x = _mm_and_ps(x, not_sign_bit);
+	__m128 temp = _mm_sub_ps(abs_x, _mm_set1_ps(1.0f));
+	temp = _mm_mul_ps(temp, x);
+	x = _mm_mul_ps(x, _mm_set1_ps(PI_4));
+	abs_x = _mm_mul_ps(abs_x, _mm_set1_ps(0.0663f));
+	abs_x = _mm_add_ps(abs_x, _mm_set1_ps(0.2447f));
+	temp = _mm_mul_ps(temp, abs_x);
+	return _mm_sub_ps(x, temp);
+}
+
+// 11th order minimax on [0, 1], atan(x) = pi/2 - atan(1/x) above, max error ~2e-6 rad
+#define ATAN_C1 0.99997726f
+#define ATAN_C3 -0.33262347f
+#define ATAN_C5 0.19354346f
+#define ATAN_C7 -0.11643287f
+#define ATAN_C9 0.05265332f
+#define ATAN_C11 -0.01172120f
+
+inline float precise_atan(float x) {
+	fp32_to_u32 f2u;
+	f2u.f = x;
+	const uint32_t sign = f2u.u & 0x80000000;
+	f2u.u &= 0x7FFFFFFF;
+	const bool big = f2u.f > 1.0f;
+	const float t = big ? 1.0f / f2u.f : f2u.f;
+	const float t2 = t * t;
+	float r = t * (ATAN_C1 + t2 * (ATAN_C3 + t2 * (ATAN_C5 + t2 * (ATAN_C7 + t2 * (ATAN_C9 + t2 * ATAN_C11)))));
+	f2u.f = big ? PI_2 - r : r;
+	f2u.u |= sign;
+	return f2u.f;
+}
+
+inline __m128 precise_atan_simd(__m128 x) {
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 sign = _mm_and_ps(x, _mm_castsi128_ps(_mm_set1_epi32(0x80000000)));
+	const __m128 abs_x = _mm_xor_ps(x, sign);
+	const __m128 big = _mm_cmpgt_ps(abs_x, one);
+	const __m128 t = _mm_or_ps(_mm_and_ps(big, _mm_div_ps(one, abs_x)), _mm_andnot_ps(big, abs_x));
+	const __m128 t2 = _mm_mul_ps(t, t);
+	__m128 r = _mm_set1_ps(ATAN_C11);
+	r = _mm_add_ps(_mm_mul_ps(r, t2), _mm_set1_ps(ATAN_C9));
+	r = _mm_add_ps(_mm_mul_ps(r, t2), _mm_set1_ps(ATAN_C7));
+	r = _mm_add_ps(_mm_mul_ps(r, t2), _mm_set1_ps(ATAN_C5));
+	r = _mm_add_ps(_mm_mul_ps(r, t2), _mm_set1_ps(ATAN_C3));
+	r = _mm_add_ps(_mm_mul_ps(r, t2), _mm_set1_ps(ATAN_C1));
+	r = _mm_mul_ps(r, t);
+	r = _mm_or_ps(_mm_and_ps(big, _mm_sub_ps(_mm_set1_ps(PI_2), r)), _mm_andnot_ps(big, r));
+	return _mm_or_ps(r, sign);
+}
+
+inline float clamp(float x, float lim) {
+	return x < -lim ? -lim : (x > lim ? lim : x);
+}
+
+inline __m128 clamp_simd(__m128 x, __m128 lim) {
+	return _mm_min_ps(_mm_max_ps(x, _mm_sub_ps(_mm_setzero_ps(), lim)), lim);
+}
+
+//------------------------------------------------------------------------
+// Curve policies, one per DistConst::Curve.
+// eval() is the transfer function, norm() the gain making a stage map coef to 1.
+// Precise selects the accurate variant where the curve has one (see quality_policy).
+//------------------------------------------------------------------------
+template <bool Precise>
+struct atan_curve {
+	static inline float eval(float x) { return Precise ? precise_atan(x) : fast_atan(x); }
+	static inline __m128 eval(__m128 x) { return Precise ? precise_atan_simd(x) : fast_atan_simd(x); }
+	static inline float norm(float coef) {
+		// evaluated in double, only done once per block
+		return Precise ? (float)(1.0 / std::atan((double)coef)) : 1.0f / fast_atan(coef);
+	}
+};
+
+// continued fraction of tanh, [7/6] or [5/4]. The approximant crosses 1 near |x| = 4.97 or 3.65
+// and the output clamp bounds it there, the +-9 input clamp only keeps x^7 from overflowing to inf/inf
+template <bool Precise>
+struct tanh_curve {
+	static inline float eval(float x) {
+		x = clamp(x, 9.0f);
+		const float x2 = x * x;
+		const float r = Precise ? x * (135135.0f + x2 * (17325.0f + x2 * (378.0f + x2))) / (135135.0f + x2 * (62370.0f + x2 * (3150.0f + x2 * 28.0f)))
+								: x * (945.0f + x2 * (105.0f + x2)) / (945.0f + x2 * (420.0f + x2 * 15.0f));
+		return clamp(r, 1.0f);
+	}
+	static inline __m128 eval(__m128 x) {
+		const __m128 one = _mm_set1_ps(1.0f);
+		x = clamp_simd(x, _mm_set1_ps(9.0f));
+		const __m128 x2 = _mm_mul_ps(x, x);
+		__m128 num, den;
+		if (Precise) {
+			num = _mm_add_ps(x2, _mm_set1_ps(378.0f));
+			num = _mm_add_ps(_mm_mul_ps(num, x2), _mm_set1_ps(17325.0f));
+			num = _mm_add_ps(_mm_mul_ps(num, x2), _mm_set1_ps(135135.0f));
+			den = _mm_add_ps(_mm_mul_ps(x2, _mm_set1_ps(28.0f)), _mm_set1_ps(3150.0f));
+			den = _mm_add_ps(_mm_mul_ps(den, x2), _mm_set1_ps(62370.0f));
+			den = _mm_add_ps(_mm_mul_ps(den, x2), _mm_set1_ps(135135.0f));
+		} else {
+			num = _mm_add_ps(x2, _mm_set1_ps(105.0f));
+			num = _mm_add_ps(_mm_mul_ps(num, x2), _mm_set1_ps(945.0f));
+			den = _mm_add_ps(_mm_mul_ps(x2, _mm_set1_ps(15.0f)), _mm_set1_ps(420.0f));
+			den = _mm_add_ps(_mm_mul_ps(den, x2), _mm_set1_ps(945.0f));
+		}
+		return clamp_simd(_mm_div_ps(_mm_mul_ps(x, num), den), one);
+	}
+	static inline float norm(float coef) {
+		return Precise ? (float)(1.0 / std::tanh((double)coef)) : 1.0f / eval(coef);
+	}
+};
+
+// 3/2 * (x - x^3 / 3) on [-1, 1], flat outside
+template <bool Precise>
+struct cubic_curve {
+	static inline float eval(float x) {
+		x = clamp(x, 1.0f);
+		const float x2 = x * x;
+		return x * (1.5f - x2 * 0.5f);
+	}
+	static inline __m128 eval(__m128 x) {
+		x = clamp_simd(x, _mm_set1_ps(1.0f));
+		const __m128 x2 = _mm_mul_ps(x, x);
+		return _mm_mul_ps(x, _mm_sub_ps(_mm_set1_ps(1.5f), _mm_mul_ps(x2, _mm_set1_ps(0.5f))));
+	}
+	static inline float norm(float coef) { return 1.0f / eval(coef); }
+};
+
+template <bool Precise>
+struct hard_curve {
+	static inline float eval(float x) { return clamp(x, 1.0f); }
+	static inline __m128 eval(__m128 x) { return clamp_simd(x, _mm_set1_ps(1.0f)); }
+	static inline float norm(float coef) { return 1.0f / eval(coef); }
+};
+
+// low order Pade shape x * (27 + x^2) / (27 + 9x^2), reaches 1 with zero slope at |x| = 3
+template <bool Precise>
+struct pade_curve {
+	static inline float eval(float x) {
+		x = clamp(x, 3.0f);
+		const float x2 = x * x;
+		return x * (27.0f + x2) / (27.0f + 9.0f * x2);
+	}
+	static inline __m128 eval(__m128 x) {
+		x = clamp_simd(x, _mm_set1_ps(3.0f));
+		const __m128 x2 = _mm_mul_ps(x, x);
+		const __m128 num = _mm_mul_ps(x, _mm_add_ps(x2, _mm_set1_ps(27.0f)));
+		const __m128 den = _mm_add_ps(_mm_mul_ps(x2, _mm_set1_ps(9.0f)), _mm_set1_ps(27.0f));
+		return _mm_div_ps(num, den);
+	}
+	static inline float norm(float coef) { return 1.0f / eval(coef); }
+};
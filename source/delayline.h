@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "alignedallocator.h"
+
+// Fixed delay used to line the dry signal up with the shaped one.
+// All memory is allocated in setup(), set_delay() and process() never allocate.
+class DelayLine {
+public:
+	void setup(int32_t max_delay, int32_t max_block) {
+		_ring.assign(max_delay, 0.0f);
+		_out.assign(max_block, 0.0f);
+		set_delay(0);
+	}
+
+	void reset() {
+		_pos = 0;
+		_ring.assign(_ring.size(), 0.0f);
+	}
+
+	void set_delay(int32_t delay) {
+		_delay = delay < (int32_t)_ring.size() ? delay : (int32_t)_ring.size();
+		reset();
+	}
+
+	int32_t delay() const { return _delay; }
+
+	// returns the input delayed by delay() samples, valid until the next call
+	const float* process(const float* in, int32_t num_samples) {
+		if (!_delay)
+			return in;
+		for (int32_t i = 0; i < num_samples; i++) {
+			_out[i] = _ring[_pos];
+			_ring[_pos] = in[i];
+			if (++_pos == _delay)
+				_pos = 0;
+		}
+		return _out.data();
+	}
+
+private:
+	aligned_vector _ring;
+	aligned_vector _out;
+	int32_t _delay = 0;
+	int32_t _pos = 0;
+};
@@ -6,7 +6,10 @@
 #include "myplugincids.h"
 #include "base/source/fstreamer.h"
 #include "pluginterfaces/base/ibstream.h"
+#include "pluginterfaces/base/smartpointer.h"
+#include "pluginterfaces/vst/ivstmessage.h"
 #include "constants.h"
+#include "paramstate.h"
 
 using namespace Steinberg;
 
@@ -62,6 +65,16 @@ tresult PLUGIN_API MyDistortionController::initialize (FUnknown* context)
 	strParam->appendString(STR16("On"));  // 1
 	parameters.addParameter(param);
 	//-----------------------------------
+	param = new Vst::StringListParameter(STR16("Curve"), MyDistParams::kParamCurveID,
+										nullptr, Vst::ParameterInfo::kCanAutomate | Vst::ParameterInfo::kIsList);
+	strParam = static_cast<Vst::StringListParameter*>(param);
+	strParam->appendString(STR16("Atan"));	// 0
+	strParam->appendString(STR16("Tanh"));  // 1
+	strParam->appendString(STR16("Cubic"));  // 2
+	strParam->appendString(STR16("Hard"));  // 3
+	strParam->appendString(STR16("Pade"));  // 4
+	parameters.addParameter(param);
+	//-----------------------------------
 	param = new Vst::RangeParameter(STR16("Gain"), MyDistParams::kParamGainID,
 									STR16(""), DistConst::GAIN_MIN,
 									DistConst::GAIN_MAX,
@@ -69,6 +82,55 @@ tresult PLUGIN_API MyDistortionController::initialize (FUnknown* context)
 
 	param->setPrecision(1);
 	parameters.addParameter(param);
+	//-----------------------------------
+	param = new Vst::StringListParameter(STR16("Stereo Mode"), MyDistParams::kParamStereoModeID,
+										nullptr, Vst::ParameterInfo::kCanAutomate | Vst::ParameterInfo::kIsList);
+	strParam = static_cast<Vst::StringListParameter*>(param);
+	strParam->appendString(STR16("Linked"));	// 0
+	strParam->appendString(STR16("L/R"));  // 1
+	strParam->appendString(STR16("M/S"));  // 2
+	parameters.addParameter(param);
+	//-----------------------------------
+	param = new Vst::RangeParameter(STR16("Coef Positive R/S"), MyDistParams::kParamCoefPos2ID,
+									STR16(""), DistConst::COEF_MIN,
+									DistConst::COEF_MAX,
+									DistConst::COEF_DEFAULT);
+
+	param->setPrecision(1);
+	parameters.addParameter(param);
+	//-----------------------------------
+	param = new Vst::RangeParameter(STR16("Coef Negative R/S"), MyDistParams::kParamCoefNeg2ID,
+									STR16(""), DistConst::COEF_MIN,
+									DistConst::COEF_MAX,
+									DistConst::COEF_DEFAULT);
+
+	param->setPrecision(1);
+	parameters.addParameter(param);
+	//-----------------------------------
+	param = new Vst::RangeParameter(STR16("Gain R/S"), MyDistParams::kParamGain2ID,
+									STR16(""), DistConst::GAIN_MIN,
+									DistConst::GAIN_MAX,
+									DistConst::GAIN_DEFAULT);
+
+	param->setPrecision(1);
+	parameters.addParameter(param);
+	//-----------------------------------
+	param = new Vst::RangeParameter(STR16("Mix"), MyDistParams::kParamMixID,
+									STR16(""), DistConst::MIX_MIN,
+									DistConst::MIX_MAX,
+									DistConst::MIX_DEFAULT);
+
+	param->setPrecision(2);
+	parameters.addParameter(param);
+	//-----------------------------------
+	// not automatable, switching it changes the latency
+	param = new Vst::StringListParameter(STR16("Quality"), MyDistParams::kParamQualityID,
+										nullptr, Vst::ParameterInfo::kIsList);
+	strParam = static_cast<Vst::StringListParameter*>(param);
+	strParam->appendString(STR16("Auto"));	// 0
+	strParam->appendString(STR16("Realtime"));  // 1
+	strParam->appendString(STR16("Offline"));  // 2
+	parameters.addParameter(param);
 	//---------------------------------
 	parameters.addParameter(STR16("Bypass"), nullptr, 1, 0,
 							Vst::ParameterInfo::kCanAutomate | Vst::ParameterInfo::kIsBypass,
@@ -92,40 +154,34 @@ tresult PLUGIN_API MyDistortionController::terminate ()
 tresult PLUGIN_API MyDistortionController::setComponentState (IBStream* state)
 {
 	// Here you get the state of the component (Processor part)
-	if (!state)
+	param_snapshot snapshot;
+	if (read_state(state, snapshot) != kResultOk)
 		return kResultFalse;
 
-	IBStreamer streamer(state, kLittleEndian);
-
-	float savedParam1;
-	if (streamer.readFloat(savedParam1) == false)
-		return kResultFalse;
 	Vst::Parameter* pParam = EditController::getParameterObject(MyDistParams::kParamCoefPosID);
-	setParamNormalized(MyDistParams::kParamCoefPosID, pParam->toNormalized(savedParam1));
+	setParamNormalized(MyDistParams::kParamCoefPosID, pParam->toNormalized(snapshot.coef_pos));
 
-	if (streamer.readFloat(savedParam1) == false)
-		return kResultFalse;
 	pParam = EditController::getParameterObject(MyDistParams::kParamCoefNegID);
-	setParamNormalized(MyDistParams::kParamCoefNegID, pParam->toNormalized(savedParam1));
+	setParamNormalized(MyDistParams::kParamCoefNegID, pParam->toNormalized(snapshot.coef_neg));
 
-	if (streamer.readFloat(savedParam1) == false)
-		return kResultFalse;
 	pParam = EditController::getParameterObject(MyDistParams::kParamNumStagesID);
-	setParamNormalized(MyDistParams::kParamNumStagesID, pParam->toNormalized(savedParam1));
+	setParamNormalized(MyDistParams::kParamNumStagesID, pParam->toNormalized(snapshot.num_stages));
 
-	int32 savedParam2;
-	if (streamer.readInt32(savedParam2) == false)
-		return kResultFalse;
-	setParamNormalized(MyDistParams::kParamInvertStagesID, savedParam2 ? 1 : 0);
+	setParamNormalized(MyDistParams::kParamInvertStagesID, snapshot.invert_stages ? 1 : 0);
+	setParamNormalized(MyDistParams::kParamGainID, snapshot.gain);
+	setParamNormalized(MyDistParams::kBypassID, snapshot.bypass ? 1 : 0);
+	setParamNormalized(MyDistParams::kParamMixID, snapshot.mix);
+	setParamNormalized(MyDistParams::kParamQualityID, (Vst::ParamValue)snapshot.quality / (DistConst::QUALITY_COUNT - 1));
+	setParamNormalized(MyDistParams::kParamCurveID, (Vst::ParamValue)snapshot.curve / (DistConst::CURVE_COUNT - 1));
+	setParamNormalized(MyDistParams::kParamStereoModeID, (Vst::ParamValue)snapshot.stereo_mode / (DistConst::STEREO_COUNT - 1));
 
-	if (streamer.readFloat(savedParam1) == false)
-		return kResultFalse;
-	setParamNormalized(MyDistParams::kParamGainID, savedParam1);
+	pParam = EditController::getParameterObject(MyDistParams::kParamCoefPos2ID);
+	setParamNormalized(MyDistParams::kParamCoefPos2ID, pParam->toNormalized(snapshot.coef_pos2));
 
-	// read the bypass
-	if (streamer.readInt32(savedParam2) == false)
-		return kResultFalse;
-	setParamNormalized(MyDistParams::kBypassID, savedParam2 ? 1 : 0);
+	pParam = EditController::getParameterObject(MyDistParams::kParamCoefNeg2ID);
+	setParamNormalized(MyDistParams::kParamCoefNeg2ID, pParam->toNormalized(snapshot.coef_neg2));
+
+	setParamNormalized(MyDistParams::kParamGain2ID, snapshot.gain2);
 
 	return kResultOk;
 }
@@ -163,7 +219,21 @@ IPlugView* PLUGIN_API MyDistortionController::createView (FIDString name)
 tresult PLUGIN_API MyDistortionController::setParamNormalized (Vst::ParamID tag, Vst::ParamValue value)
 {
 	// called by host to update your parameters
+	const bool latency_changed = tag == MyDistParams::kParamQualityID && value != getParamNormalized (tag);
 	tresult result = EditControllerEx1::setParamNormalized (tag, value);
+	if (result == kResultOk && latency_changed)
+	{
+		// the processor reports latency for the requested quality, so it has to know it
+		// before the host asks, the parameter queue only reaches it with the next block
+		if (IPtr<Vst::IMessage> message = owned (allocateMessage ()))
+		{
+			message->setMessageID (DistConst::QUALITY_MESSAGE_ID);
+			message->getAttributes ()->setInt (DistConst::QUALITY_MESSAGE_VALUE, (int64)(value * (DistConst::QUALITY_COUNT - 1) + 0.5));
+			sendMessage (message);
+		}
+		if (componentHandler)
+			componentHandler->restartComponent (Vst::kLatencyChanged);
+	}
 	return result;
 }
 
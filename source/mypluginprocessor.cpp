@@ -7,12 +7,18 @@
 
 #include "base/source/fstreamer.h"
 #include "pluginterfaces/base/ibstream.h"
+#include "pluginterfaces/vst/ivstmessage.h"
 #include "pluginterfaces/vst/ivstparameterchanges.h"
 
 #include "constants.h"
+#include "paramstate.h"
 
-extern void waveshaper(float* in, float* out, int buf_len, const params p);
-extern void waveshaper_simd(float* in, float* out, int buf_len, const params p);
+#include <cmath>
+
+extern void waveshaper(float* in, const float* dry, float* out, int buf_len, const params p);
+extern void waveshaper_simd(float* in, const float* dry, float* out, int buf_len, const params p);
+extern void waveshaper_stereo_simd(float* const* in, const float* const* dry, float* const* out, int buf_len, const params p);
+extern void dry_wet_simd(const float* dry, float* out, int buf_len, const params p);
 
 using namespace Steinberg;
 
@@ -26,12 +32,12 @@ inline T scale_range(T newRangeMax, T newRangeMin, T originalValue) noexcept {
 //------------------------------------------------------------------------
 // MyDistortionProcessor
 //------------------------------------------------------------------------
-MyDistortionProcessor::MyDistortionProcessor () :	_coef_pos(DistConst::COEF_DEFAULT), 
-													_coef_neg(DistConst::COEF_DEFAULT),
-													_num_stages(DistConst::NUM_STAGES_DEFAULT),
-													_invert_stages(1),
-													_gain(DistConst::GAIN_DEFAULT),
-													_bypass(0)
+MyDistortionProcessor::MyDistortionProcessor () :	_mix_smoothed(DistConst::MIX_DEFAULT),
+													_version(0),
+													_requested_quality(DistConst::QUALITY_AUTO),
+													_active_quality(DistConst::QUALITY_REALTIME),
+													_policy(DistConst::QUALITY_POLICY_REALTIME),
+													_latency(0)
 {
 	//--- set the wanted controller for our processor
 	setControllerClass (kMyDistortionControllerUID);
@@ -77,6 +83,13 @@ tresult PLUGIN_API MyDistortionProcessor::terminate ()
 tresult PLUGIN_API MyDistortionProcessor::setActive (TBool state)
 {
 	//--- called when the Plug-in is enable/disable (On/Off) -----
+	if (state) {
+		for (auto& dl : _dry_delay)
+			dl.reset();
+		for (auto& os : _oversampler)
+			os.reset();
+		_mix_smoothed = (float)_params.mix;
+	}
 
 	return AudioEffect::setActive (state);
 }
@@ -84,6 +97,9 @@ tresult PLUGIN_API MyDistortionProcessor::setActive (TBool state)
 //------------------------------------------------------------------------
 tresult PLUGIN_API MyDistortionProcessor::process (Vst::ProcessData& data)
 {
+	//--- Pick up a state loaded since the last block ---
+	pickUpState();
+
 	//--- First : Read inputs parameter changes-----------
 
 	if (data.inputParameterChanges)
@@ -103,37 +119,82 @@ tresult PLUGIN_API MyDistortionProcessor::process (Vst::ProcessData& data)
 				case MyDistParams::kParamCoefPosID:
 					if (paramQueue->getPoint(numPoints - 1, sampleOffset, value) ==
 						kResultTrue)
-						_coef_pos = scale_range<Steinberg::Vst::ParamValue>(DistConst::COEF_MAX, DistConst::COEF_MIN, value);
+						_params.coef_pos = scale_range<Steinberg::Vst::ParamValue>(DistConst::COEF_MAX, DistConst::COEF_MIN, value);
 					break;
 				case MyDistParams::kParamCoefNegID:
 					if (paramQueue->getPoint(numPoints - 1, sampleOffset, value) ==
 						kResultTrue)
-						_coef_neg = scale_range<Steinberg::Vst::ParamValue>(DistConst::COEF_MAX, DistConst::COEF_MIN, value);
+						_params.coef_neg = scale_range<Steinberg::Vst::ParamValue>(DistConst::COEF_MAX, DistConst::COEF_MIN, value);
 					break;
 				case MyDistParams::kParamNumStagesID:
 					if (paramQueue->getPoint(numPoints - 1, sampleOffset, value) ==
 						kResultTrue)
-						_num_stages = scale_range<Steinberg::Vst::ParamValue>(DistConst::NUM_STAGES_MAX, DistConst::NUM_STAGES_MIN, value);
+						_params.num_stages = scale_range<Steinberg::Vst::ParamValue>(DistConst::NUM_STAGES_MAX, DistConst::NUM_STAGES_MIN, value);
 					break;
 				case MyDistParams::kParamInvertStagesID:
 					if (paramQueue->getPoint(numPoints - 1, sampleOffset, value) ==
 						kResultTrue)
-						_invert_stages = value > 0.5f;
+						_params.invert_stages = value > 0.5f;
+					break;
+				case MyDistParams::kParamCurveID:
+					if (paramQueue->getPoint(numPoints - 1, sampleOffset, value) ==
+						kResultTrue)
+						_params.curve = (int32)(value * (DistConst::CURVE_COUNT - 1) + 0.5);
+					break;
+				case MyDistParams::kParamStereoModeID:
+					if (paramQueue->getPoint(numPoints - 1, sampleOffset, value) ==
+						kResultTrue)
+						_params.stereo_mode = (int32)(value * (DistConst::STEREO_COUNT - 1) + 0.5);
+					break;
+				case MyDistParams::kParamCoefPos2ID:
+					if (paramQueue->getPoint(numPoints - 1, sampleOffset, value) ==
+						kResultTrue)
+						_params.coef_pos2 = scale_range<Steinberg::Vst::ParamValue>(DistConst::COEF_MAX, DistConst::COEF_MIN, value);
+					break;
+				case MyDistParams::kParamCoefNeg2ID:
+					if (paramQueue->getPoint(numPoints - 1, sampleOffset, value) ==
+						kResultTrue)
+						_params.coef_neg2 = scale_range<Steinberg::Vst::ParamValue>(DistConst::COEF_MAX, DistConst::COEF_MIN, value);
+					break;
+				case MyDistParams::kParamGain2ID:
+					if (paramQueue->getPoint(numPoints - 1, sampleOffset, value) ==
+						kResultTrue)
+						_params.gain2 = value;
 					break;
 				case MyDistParams::kParamGainID:
 					if (paramQueue->getPoint(numPoints - 1, sampleOffset, value) ==
 						kResultTrue)
-						_gain = value;
+						_params.gain = value;
 					break;
 				case MyDistParams::kBypassID:
 					if (paramQueue->getPoint(numPoints - 1, sampleOffset, value) ==
 						kResultTrue)
-						_bypass = value > 0.5f;
+						_params.bypass = value > 0.5f;
+					break;
+				case MyDistParams::kParamMixID:
+					if (paramQueue->getPoint(numPoints - 1, sampleOffset, value) ==
+						kResultTrue)
+						_params.mix = value;
+					break;
+				case MyDistParams::kParamQualityID:
+					if (paramQueue->getPoint(numPoints - 1, sampleOffset, value) ==
+						kResultTrue)
+					{
+						_params.quality = (int32)(value * (DistConst::QUALITY_COUNT - 1) + 0.5);
+						_requested_quality = _params.quality;
+					}
 					break;
 				}
 			}
 		}
+		if (numParamsChanged > 0) {
+			// make automation visible to getState
+			_params.version = ++_version;
+			_published.write_buffer() = _params;
+			_published.publish();
+		}
 	}
+	updateQuality(false);
 	
 	//--- Here you have to implement your processing
 	if (data.numInputs == 0 || data.numOutputs == 0)
@@ -147,18 +208,60 @@ tresult PLUGIN_API MyDistortionProcessor::process (Vst::ProcessData& data)
 		Vst::SpeakerArrangement arr;
 		getBusArrangement(Vst::kOutput, 0, arr);
 		int32 numChannels = Vst::SpeakerArr::getChannelCount(arr);
+		if (numChannels > MAX_CHANNELS)
+			numChannels = MAX_CHANNELS;
+		if (numChannels == 0)
+			return kResultOk;	// empty arrangement, the kernels below expect at least one channel
+
+		// one-pole smoothing of the mix per block, the kernel ramps linearly across it
+		const float mix_start = _mix_smoothed;
+		const float mix_coef = 1.0f - std::exp(-(float)data.numSamples / (DistConst::MIX_SMOOTH_TIME * (float)processSetup.sampleRate));
+		_mix_smoothed += ((float)_params.mix - _mix_smoothed) * mix_coef;
+		if (std::fabs((float)_params.mix - _mix_smoothed) < 1e-5f)
+			_mix_smoothed = (float)_params.mix;
+
+		float* in[MAX_CHANNELS];
+		float* out[MAX_CHANNELS];
+		const float* dry[MAX_CHANNELS];
+		for (int32 channel = 0; channel < numChannels; channel++) {
+			in[channel] = (float*)data.inputs[0].channelBuffers32[channel];
+			out[channel] = (float*)data.outputs[0].channelBuffers32[channel];
+			// the delay line keeps running while bypassed so the latency stays constant
+			dry[channel] = _dry_delay[channel].process(in[channel], data.numSamples);
+		}
 
-		if (_bypass) {
+		if (_params.bypass) {
 			for (int32 channel = 0; channel < numChannels; channel++) {
 				for (int32 sample = 0, sz = data.numSamples; sample < sz; sample++) {
-					data.outputs[0].channelBuffers32[channel][sample] = data.inputs[0].channelBuffers32[channel][sample];
+					out[channel][sample] = dry[channel][sample];
 				}
 			}
 		} else {
 			// Process Algorithm
-			for (int32 channel = 0; channel < numChannels; channel++) {
-				params p = { (float)_coef_pos, (float)_coef_neg, (int32_t)_num_stages, (int32_t)_invert_stages, (float)_gain };
-				waveshaper_simd((float*)data.inputs[0].channelBuffers32[channel], (float*)data.outputs[0].channelBuffers32[channel], data.numSamples, p);
+			const bool linked = _params.stereo_mode == DistConst::STEREO_LINKED;
+			params p = { { (float)_params.coef_pos, (float)(linked ? _params.coef_pos : _params.coef_pos2) },
+						 { (float)_params.coef_neg, (float)(linked ? _params.coef_neg : _params.coef_neg2) },
+						 (int32_t)_params.num_stages, (int32_t)_params.invert_stages,
+						 { (float)_params.gain, (float)(linked ? _params.gain : _params.gain2) },
+						 mix_start, _mix_smoothed, _policy.precise, (int32_t)_params.curve, (int32_t)_params.stereo_mode };
+
+			if (_policy.oversampling > 1) {
+				// shape at the doubled rate, the dry path is blended back at the host rate
+				float* up[MAX_CHANNELS];
+				for (int32 channel = 0; channel < numChannels; channel++)
+					up[channel] = _oversampler[channel].upsample(in[channel], data.numSamples);
+				if (numChannels == 2)
+					waveshaper_stereo_simd(up, nullptr, up, data.numSamples * 2, p);
+				else
+					waveshaper_simd(up[0], nullptr, up[0], data.numSamples * 2, p);
+				for (int32 channel = 0; channel < numChannels; channel++) {
+					_oversampler[channel].downsample(up[channel], out[channel], data.numSamples);
+					dry_wet_simd(dry[channel], out[channel], data.numSamples, p);
+				}
+			} else if (numChannels == 2) {
+				waveshaper_stereo_simd(in, dry, out, data.numSamples, p);
+			} else {
+				waveshaper_simd(in[0], dry[0], out[0], data.numSamples, p);
 			}
 		}
 	}
@@ -171,7 +274,85 @@ tresult PLUGIN_API MyDistortionProcessor::process (Vst::ProcessData& data)
 tresult PLUGIN_API MyDistortionProcessor::setupProcessing (Vst::ProcessSetup& newSetup)
 {
 	//--- called before any processing ----
-	return AudioEffect::setupProcessing (newSetup);
+	tresult result = AudioEffect::setupProcessing (newSetup);
+	if (result != kResultOk)
+		return result;
+
+	// sized for the heaviest policy so switching quality never allocates
+	for (auto& dl : _dry_delay)
+		dl.setup(Oversampler::LATENCY, newSetup.maxSamplesPerBlock);
+	for (auto& os : _oversampler)
+		os.setup(newSetup.maxSamplesPerBlock);
+	pickUpState();
+	updateQuality(true);
+
+	return kResultOk;
+}
+
+//------------------------------------------------------------------------
+void MyDistortionProcessor::pickUpState ()
+{
+	if (_pending.update()) {
+		// republished under a new version, automation published since setState
+		// was built on the old parameters and must not win in getState
+		_params = _pending.read_buffer();
+		_params.version = ++_version;
+		_published.write_buffer() = _params;
+		_published.publish();
+	}
+
+	// getLatencySamples already reports the requested quality, so it is applied without waiting
+	// for the parameter queue. It is not published on its own: setState stores it before its
+	// snapshot, so until that snapshot is picked up it does not belong to the parameters above
+	_params.quality = _requested_quality.load(std::memory_order_relaxed);
+}
+
+//------------------------------------------------------------------------
+int32 MyDistortionProcessor::resolveQuality (int32 quality) const
+{
+	if (quality == DistConst::QUALITY_AUTO)
+		return processSetup.processMode == Vst::kOffline ? DistConst::QUALITY_OFFLINE : DistConst::QUALITY_REALTIME;
+	return quality;
+}
+
+//------------------------------------------------------------------------
+void MyDistortionProcessor::updateQuality (bool force)
+{
+	const int32 quality = resolveQuality(_params.quality);
+	if (quality == _active_quality && !force)
+		return;
+
+	_active_quality = quality;
+	_policy = quality == DistConst::QUALITY_OFFLINE ? DistConst::QUALITY_POLICY_OFFLINE : DistConst::QUALITY_POLICY_REALTIME;
+	_latency = _policy.oversampling > 1 ? Oversampler::LATENCY : 0;
+	for (auto& dl : _dry_delay)
+		dl.set_delay(_latency);
+	for (auto& os : _oversampler)
+		os.reset();
+}
+
+//------------------------------------------------------------------------
+uint32 PLUGIN_API MyDistortionProcessor::getLatencySamples ()
+{
+	// the host asks right after kLatencyChanged, possibly before the audio thread applied the
+	// new quality, so answer for the requested one rather than _latency
+	const int32 quality = resolveQuality(_requested_quality.load(std::memory_order_relaxed));
+	const quality_policy policy = quality == DistConst::QUALITY_OFFLINE ? DistConst::QUALITY_POLICY_OFFLINE : DistConst::QUALITY_POLICY_REALTIME;
+	return policy.oversampling > 1 ? Oversampler::LATENCY : 0;
+}
+
+//------------------------------------------------------------------------
+tresult PLUGIN_API MyDistortionProcessor::notify (Vst::IMessage* message)
+{
+	if (message && FIDStringsEqual(message->getMessageID(), DistConst::QUALITY_MESSAGE_ID)) {
+		int64 quality;
+		if (message->getAttributes()->getInt(DistConst::QUALITY_MESSAGE_VALUE, quality) != kResultOk
+			|| quality < 0 || quality >= DistConst::QUALITY_COUNT)
+			return kResultFalse;
+		_requested_quality = (int32)quality;
+		return kResultOk;
+	}
+	return AudioEffect::notify(message);
 }
 
 //------------------------------------------------------------------------
@@ -189,33 +370,33 @@ tresult PLUGIN_API MyDistortionProcessor::canProcessSampleSize (int32 symbolicSa
 }
 
 //------------------------------------------------------------------------
-tresult PLUGIN_API MyDistortionProcessor::setState (IBStream* state)
+tresult PLUGIN_API MyDistortionProcessor::setBusArrangements (Vst::SpeakerArrangement* inputs, int32 numIns,
+															  Vst::SpeakerArrangement* outputs, int32 numOuts)
 {
-	// called when we load a preset, the model has to be reloaded
-	IBStreamer streamer (state, kLittleEndian);
-	
-	float res;
-	if (streamer.readFloat(res) == false)
-		return kResultFalse;
-	_coef_pos = res;
-
-	if (streamer.readFloat(res) == false)
-		return kResultFalse;
-	_coef_neg = res;
-
-	if (streamer.readFloat(res) == false)
+	// wider buses would leave the extra channels unprocessed
+	if (numIns != 1 || numOuts != 1
+		|| Vst::SpeakerArr::getChannelCount(inputs[0]) > MAX_CHANNELS
+		|| Vst::SpeakerArr::getChannelCount(outputs[0]) > MAX_CHANNELS)
 		return kResultFalse;
-	_num_stages = res;
 
-	if (streamer.readInt32(_invert_stages) == false)
-		return kResultFalse;
+	return AudioEffect::setBusArrangements (inputs, numIns, outputs, numOuts);
+}
 
-	if (streamer.readFloat(res) == false)
+//------------------------------------------------------------------------
+tresult PLUGIN_API MyDistortionProcessor::setState (IBStream* state)
+{
+	// called when we load a preset, the model has to be reloaded
+	param_snapshot snapshot;
+	if (read_state(state, snapshot) != kResultOk)
 		return kResultFalse;
-	_gain = res;
+	snapshot.version = ++_version;
+	// before publishing, or the audio thread could adopt the snapshot and then revert its quality
+	_requested_quality = snapshot.quality;
 
-	if (streamer.readInt32(_bypass) == false)
-		return kResultFalse;
+	// the audio thread picks it up at the start of its next block
+	_state = snapshot;
+	_pending.write_buffer() = snapshot;
+	_pending.publish();
 
 	return kResultOk;
 }
@@ -223,15 +404,11 @@ tresult PLUGIN_API MyDistortionProcessor::setState (IBStream* state)
 //------------------------------------------------------------------------
 tresult PLUGIN_API MyDistortionProcessor::getState (IBStream* state)
 {
-	IBStreamer streamer(state, kLittleEndian);
-	streamer.writeFloat((float)_coef_pos);
-	streamer.writeFloat((float)_coef_neg);
-	streamer.writeFloat((float)_num_stages);
-	streamer.writeInt32(_invert_stages);
-	streamer.writeFloat((float)_gain);
-	streamer.writeInt32(_bypass);
+	// whichever is newer, the last loaded state or what the audio thread runs with
+	_published.update();
+	const param_snapshot& current = _published.read_buffer();
 
-	return kResultOk;
+	return write_state(state, current.version > _state.version ? current : _state);
 }
 
 //------------------------------------------------------------------------
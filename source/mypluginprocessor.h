@@ -6,6 +6,14 @@
 
 #include "public.sdk/source/vst/vstaudioeffect.h"
 
+#include "constants.h"
+#include "delayline.h"
+#include "oversampler.h"
+#include "paramstate.h"
+#include "triplebuffer.h"
+
+#include <atomic>
+
 namespace MyCompanyName {
 
 //------------------------------------------------------------------------
@@ -41,21 +49,51 @@ public:
 	/** Asks if a given sample size is supported see SymbolicSampleSizes. */
 	Steinberg::tresult PLUGIN_API canProcessSampleSize (Steinberg::int32 symbolicSampleSize) SMTG_OVERRIDE;
 
+	/** Accepts up to MAX_CHANNELS channels, the dry delay lines are allocated per channel */
+	Steinberg::tresult PLUGIN_API setBusArrangements (Steinberg::Vst::SpeakerArrangement* inputs, Steinberg::int32 numIns,
+													  Steinberg::Vst::SpeakerArrangement* outputs, Steinberg::int32 numOuts) SMTG_OVERRIDE;
+
+	/** Latency of the shaped signal, the dry path is delayed to match it */
+	Steinberg::uint32 PLUGIN_API getLatencySamples () SMTG_OVERRIDE;
+
 	/** Here we go...the process call */
 	Steinberg::tresult PLUGIN_API process (Steinberg::Vst::ProcessData& data) SMTG_OVERRIDE;
 		
+	/** Quality requested by the controller, ahead of the parameter queue */
+	Steinberg::tresult PLUGIN_API notify (Steinberg::Vst::IMessage* message) SMTG_OVERRIDE;
+
 	/** For persistence */
 	Steinberg::tresult PLUGIN_API setState (Steinberg::IBStream* state) SMTG_OVERRIDE;
 	Steinberg::tresult PLUGIN_API getState (Steinberg::IBStream* state) SMTG_OVERRIDE;
 
 	//------------------------------------------------------------------------
 protected:
-	Steinberg::Vst::ParamValue _coef_pos;	// 0.1f ... 2.0f
-	Steinberg::Vst::ParamValue _coef_neg;	// 0.1f ... 2.0f
-	Steinberg::Vst::ParamValue _num_stages;	// 1 ... 10
-	Steinberg::int32 _invert_stages; // 0 ... 1
-	Steinberg::Vst::ParamValue _gain;	// 0.0f ... 1.0f
-	Steinberg::int32 _bypass;
+	/** Resolves the quality setting against the process mode and applies its policy */
+	void updateQuality (bool force);
+
+	/** Resolves QUALITY_AUTO against the process mode */
+	Steinberg::int32 resolveQuality (Steinberg::int32 quality) const;
+
+	/** Adopts and republishes the last state loaded by setState, then applies the requested quality, audio thread only */
+	void pickUpState ();
+
+	param_snapshot _params;	// audio thread working set
+	float _mix_smoothed;
+
+	// setState -> audio thread, and audio thread -> getState
+	param_snapshot _state;	// last loaded state, UI thread only
+	TripleBuffer<param_snapshot> _pending;
+	TripleBuffer<param_snapshot> _published;
+	std::atomic<Steinberg::uint32> _version;
+
+	std::atomic<Steinberg::int32> _requested_quality;	// latest quality from the controller, setState or automation
+	Steinberg::int32 _active_quality;	// _params.quality with QUALITY_AUTO resolved
+	quality_policy _policy;
+
+	static constexpr Steinberg::int32 MAX_CHANNELS = 2;
+	Steinberg::int32 _latency;
+	DelayLine _dry_delay[MAX_CHANNELS];
+	Oversampler _oversampler[MAX_CHANNELS];
 };
 
 //------------------------------------------------------------------------
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <stdint.h>
+#include <cmath>
+#include <vector>
+#include <xmmintrin.h>
+
+#include "alignedallocator.h"
+
+// 2x up/down sampler built from a linear phase halfband FIR (blackman windowed sinc).
+// Only the even taps of the halfband are non zero besides the centre one, so each
+// direction costs a single TAPS long FIR per input sample.
+// All memory is allocated in setup(), upsample()/downsample() never allocate.
+class Oversampler {
+public:
+	static constexpr int32_t TAPS = 32;				// non zero taps of one polyphase branch
+	static constexpr int32_t HIST = TAPS - 1;
+	static constexpr int32_t LATENCY = TAPS - 1;	// up + down, in host rate samples
+
+	void setup(int32_t max_block) {
+		const int32_t len = 2 * TAPS - 1;	// full halfband length
+		const int32_t centre = TAPS - 1;
+		const double pi = 3.14159265358979323846;
+		double sum = 0.0;
+		double h[TAPS];
+		for (int32_t j = 0; j < TAPS; j++) {
+			const int32_t k = 2 * j;
+			const double t = 0.5 * (double)(k - centre);
+			const double w = 0.42 - 0.5 * std::cos(2.0 * pi * k / (len - 1)) + 0.08 * std::cos(4.0 * pi * k / (len - 1));
+			h[j] = w * std::sin(pi * t) / (pi * t);
+			sum += h[j];
+		}
+		// the branch sums to 1 for unity gain at DC, stored reversed for a forward dot product
+		for (int32_t j = 0; j < TAPS; j++)
+			_taps[TAPS - 1 - j] = (float)(h[j] / sum);
+
+		_up_in.assign(HIST + max_block, 0.0f);
+		_up_out.assign(2 * max_block, 0.0f);
+		_down_even.assign(HIST + max_block, 0.0f);
+		_down_odd.assign(HIST + max_block, 0.0f);
+	}
+
+	void reset() {
+		_up_in.assign(_up_in.size(), 0.0f);
+		_down_even.assign(_down_even.size(), 0.0f);
+		_down_odd.assign(_down_odd.size(), 0.0f);
+	}
+
+	// returns 2 * num_samples samples at the doubled rate, 16 byte aligned, valid until the next call
+	float* upsample(const float* in, int32_t num_samples) {
+		float* x = _up_in.data();
+		float* y = _up_out.data();
+		for (int32_t i = 0; i < num_samples; i++)
+			x[HIST + i] = in[i];
+
+		// even outputs are filtered, odd outputs land on the centre tap
+		int32_t i = 0;
+		for (; i + 4 <= num_samples; i += 4) {
+			const __m128 even = fir4(x + i);
+			const __m128 odd = _mm_loadu_ps(x + i + TAPS / 2);
+			_mm_storeu_ps(y + 2 * i, _mm_unpacklo_ps(even, odd));
+			_mm_storeu_ps(y + 2 * i + 4, _mm_unpackhi_ps(even, odd));
+		}
+		for (; i < num_samples; i++) {
+			y[2 * i] = fir1(x + i);
+			y[2 * i + 1] = x[i + TAPS / 2];
+		}
+
+		save_history(x, num_samples);
+		return y;
+	}
+
+	// consumes 2 * num_samples samples at the doubled rate
+	void downsample(const float* in, float* out, int32_t num_samples) {
+		float* even = _down_even.data();
+		float* odd = _down_odd.data();
+		for (int32_t i = 0; i < num_samples; i++) {
+			even[HIST + i] = in[2 * i];
+			odd[HIST + i] = in[2 * i + 1];
+		}
+
+		const __m128 half = _mm_set1_ps(0.5f);
+		int32_t i = 0;
+		for (; i + 4 <= num_samples; i += 4) {
+			const __m128 centre = _mm_loadu_ps(odd + i + TAPS / 2 - 1);
+			_mm_storeu_ps(out + i, _mm_mul_ps(_mm_add_ps(fir4(even + i), centre), half));
+		}
+		for (; i < num_samples; i++)
+			out[i] = 0.5f * (fir1(even + i) + odd[i + TAPS / 2 - 1]);
+
+		save_history(even, num_samples);
+		save_history(odd, num_samples);
+	}
+
+private:
+	// four consecutive outputs of the branch filter starting at x[TAPS - 1]
+	inline __m128 fir4(const float* x) const {
+		__m128 acc = _mm_setzero_ps();
+		for (int32_t m = 0; m < TAPS; m++)
+			acc = _mm_add_ps(acc, _mm_mul_ps(_mm_load1_ps(&_taps[m]), _mm_loadu_ps(x + m)));
+		return acc;
+	}
+
+	inline float fir1(const float* x) const {
+		float acc = 0.0f;
+		for (int32_t m = 0; m < TAPS; m++)
+			acc += _taps[m] * x[m];
+		return acc;
+	}
+
+	static inline void save_history(float* buf, int32_t num_samples) {
+		for (int32_t i = 0; i < HIST; i++)
+			buf[i] = buf[num_samples + i];
+	}
+
+	float _taps[TAPS];
+	aligned_vector _up_in;
+	aligned_vector _up_out;	// handed to the aligned kernels
+	aligned_vector _down_even;
+	aligned_vector _down_odd;
+};
@@ -0,0 +1,152 @@
+//------------------------------------------------------------------------
+// Copyright(c) 2021 Alex Suprunov.
+//------------------------------------------------------------------------
+
+#include "paramstate.h"
+
+#include "base/source/fstreamer.h"
+
+#include <string.h>
+
+using namespace Steinberg;
+
+namespace MyCompanyName {
+
+// states written before the header have to hold at least up to bypass
+static constexpr int32 LEGACY_REQUIRED_FIELDS = 6;
+
+//------------------------------------------------------------------------
+// visits the persisted fields in stream order, stops as soon as the visitor returns false
+template <typename Visitor>
+static bool visit_fields (param_snapshot& s, Visitor& v)
+{
+	return v(s.coef_pos) && v(s.coef_neg) && v(s.num_stages) && v(s.invert_stages) && v(s.gain) && v(s.bypass)
+		&& v(s.mix) && v(s.quality) && v(s.curve)
+		&& v(s.stereo_mode) && v(s.coef_pos2) && v(s.coef_neg2) && v(s.gain2);
+}
+
+struct field_sizer {
+	int32 size = 0;
+	bool operator() (Vst::ParamValue&) { size += sizeof(float); return true; }
+	bool operator() (int32&) { size += sizeof(int32); return true; }
+};
+
+struct field_writer {
+	IBStreamer& streamer;
+	bool operator() (Vst::ParamValue& v) { return streamer.writeFloat((float)v); }
+	bool operator() (int32& v) { return streamer.writeInt32(v); }
+};
+
+struct field_reader {
+	IBStreamer& streamer;
+	int32 remaining;	// payload bytes left
+	int32 skip;			// leading fields already read by the caller
+	int32 count = 0;	// fields read from the stream
+	bool failed = false;
+
+	bool operator() (Vst::ParamValue& v) {
+		float res;
+		if (skip > 0) {
+			skip--;
+			return true;
+		}
+		if (remaining < (int32)sizeof(res))
+			return false;
+		if (streamer.readFloat(res) == false) {
+			failed = true;
+			return false;
+		}
+		remaining -= sizeof(res);
+		count++;
+		v = res;
+		return true;
+	}
+	bool operator() (int32& v) {
+		int32 res;
+		if (skip > 0) {
+			skip--;
+			return true;
+		}
+		if (remaining < (int32)sizeof(res))
+			return false;
+		if (streamer.readInt32(res) == false) {
+			failed = true;
+			return false;
+		}
+		remaining -= sizeof(res);
+		count++;
+		v = res;
+		return true;
+	}
+};
+
+//------------------------------------------------------------------------
+tresult read_state (IBStream* state, param_snapshot& snapshot)
+{
+	if (!state)
+		return kResultFalse;
+
+	IBStreamer streamer (state, kLittleEndian);
+
+	int32 magic;
+	if (streamer.readInt32(magic) == false)
+		return kResultFalse;
+
+	param_snapshot s;
+	if (magic != STATE_MAGIC) {
+		// legacy state, the first word already was coef_pos and the size is unknown
+		float coef_pos;
+		memcpy(&coef_pos, &magic, sizeof(coef_pos));
+		s.coef_pos = coef_pos;
+
+		// a failed read is just the end of an older, shorter state
+		field_reader reader { streamer, 0x7FFFFFFF, 1 };
+		visit_fields(s, reader);
+		if (1 + reader.count < LEGACY_REQUIRED_FIELDS)
+			return kResultFalse;
+	} else {
+		int32 version, size;
+		if (streamer.readInt32(version) == false || streamer.readInt32(size) == false || size < 0)
+			return kResultFalse;
+
+		field_reader reader { streamer, size, 0 };
+		visit_fields(s, reader);
+		if (reader.failed)
+			return kResultFalse;
+
+		// fields appended by newer versions
+		for (int8 unknown; reader.remaining > 0; reader.remaining--) {
+			if (streamer.readInt8(unknown) == false)
+				return kResultFalse;
+		}
+	}
+
+	snapshot = s;
+	return kResultOk;
+}
+
+//------------------------------------------------------------------------
+tresult write_state (IBStream* state, const param_snapshot& snapshot)
+{
+	if (!state)
+		return kResultFalse;
+
+	IBStreamer streamer (state, kLittleEndian);
+
+	param_snapshot s = snapshot;
+	field_sizer sizer;
+	visit_fields(s, sizer);
+
+	streamer.writeInt32(STATE_MAGIC);
+	streamer.writeInt32(STATE_VERSION);
+	streamer.writeInt32(sizer.size);
+
+	field_writer writer { streamer };
+	if (!visit_fields(s, writer))
+		return kResultFalse;
+
+	return kResultOk;
+}
+
+//------------------------------------------------------------------------
+} // namespace MyCompanyName
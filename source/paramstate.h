@@ -0,0 +1,43 @@
+#pragma once
+
+#include "pluginterfaces/base/ibstream.h"
+#include "pluginterfaces/vst/vsttypes.h"
+
+#include "constants.h"
+
+namespace MyCompanyName {
+
+// plain values of every persisted parameter, published to the audio thread as a whole
+struct param_snapshot {
+	Steinberg::Vst::ParamValue coef_pos = Steinberg::DistConst::COEF_DEFAULT;	// 0.1f ... 2.0f
+	Steinberg::Vst::ParamValue coef_neg = Steinberg::DistConst::COEF_DEFAULT;	// 0.1f ... 2.0f
+	Steinberg::Vst::ParamValue num_stages = Steinberg::DistConst::NUM_STAGES_DEFAULT;	// 1 ... 10
+	Steinberg::int32 invert_stages = 1;	// 0 ... 1
+	Steinberg::Vst::ParamValue gain = Steinberg::DistConst::GAIN_DEFAULT;	// 0.0f ... 1.0f
+	Steinberg::int32 bypass = 0;
+	Steinberg::Vst::ParamValue mix = Steinberg::DistConst::MIX_DEFAULT;	// 0.0f ... 1.0f
+	Steinberg::int32 quality = Steinberg::DistConst::QUALITY_AUTO;
+	Steinberg::int32 curve = Steinberg::DistConst::CURVE_ATAN;
+	Steinberg::int32 stereo_mode = Steinberg::DistConst::STEREO_LINKED;
+	Steinberg::Vst::ParamValue coef_pos2 = Steinberg::DistConst::COEF_DEFAULT;	// right or side, 0.1f ... 2.0f
+	Steinberg::Vst::ParamValue coef_neg2 = Steinberg::DistConst::COEF_DEFAULT;	// right or side, 0.1f ... 2.0f
+	Steinberg::Vst::ParamValue gain2 = Steinberg::DistConst::GAIN_DEFAULT;	// right or side, 0.0f ... 1.0f
+
+	Steinberg::uint32 version = 0;	// not persisted, orders snapshots made on different threads
+};
+
+//------------------------------------------------------------------------
+// State format:
+//   int32 STATE_MAGIC, int32 STATE_VERSION, int32 payload size in bytes, payload
+// The payload holds the fields of param_snapshot in declaration order, new fields are
+// only ever appended. Readers keep defaults for fields past the payload size and skip
+// fields they don't know. States written before the header existed are still read.
+//------------------------------------------------------------------------
+static constexpr Steinberg::int32 STATE_MAGIC = 0x4D445354;	// 'MDST', never a valid legacy coef_pos
+static constexpr Steinberg::int32 STATE_VERSION = 1;
+
+Steinberg::tresult read_state (Steinberg::IBStream* state, param_snapshot& snapshot);
+Steinberg::tresult write_state (Steinberg::IBStream* state, const param_snapshot& snapshot);
+
+//------------------------------------------------------------------------
+} // namespace MyCompanyName
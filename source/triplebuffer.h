@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+// Single producer / single consumer triple buffer.
+// Both sides are wait-free: the producer fills write_buffer() and publishes it,
+// the consumer picks up the latest published value with update().
+template <typename T>
+class TripleBuffer {
+public:
+	TripleBuffer() : _middle(1), _back(0), _front(2) {}
+
+	// producer side
+	T& write_buffer() { return _buf[_back]; }
+
+	void publish() {
+		_back = _middle.exchange(_back | DIRTY, std::memory_order_acq_rel) & INDEX;
+	}
+
+	// consumer side, returns true when a newer value was picked up
+	bool update() {
+		if (!(_middle.load(std::memory_order_relaxed) & DIRTY))
+			return false;
+		_front = _middle.exchange(_front, std::memory_order_acq_rel) & INDEX;
+		return true;
+	}
+
+	const T& read_buffer() const { return _buf[_front]; }
+
+private:
+	static constexpr uint8_t INDEX = 0x03;
+	static constexpr uint8_t DIRTY = 0x04;
+
+	T _buf[3];
+	std::atomic<uint8_t> _middle;	// index of the shared buffer, DIRTY when not picked up yet
+	uint8_t _back;
+	uint8_t _front;
+};
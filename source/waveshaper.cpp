@@ -3,100 +3,330 @@
 #include <emmintrin.h>
 
 #include "constants.h"
+#include "curves.h"
 
-#define M_PI_4 0.785398163397448309616f  // pi/4
+// the normalisation only depends on which coefficient is selected, so it is hoisted out of the stages
+struct stage_coefs {
+	float coef_pos, coef_neg;
+	float norm_pos, norm_neg;
+	float gain;
+};
 
+template <typename Curve>
+inline stage_coefs make_coefs(const params& p, int channel) {
+	return { p.coef_pos[channel], p.coef_neg[channel],
+			 Curve::norm(p.coef_pos[channel]), Curve::norm(p.coef_neg[channel]),
+			 p.gain[channel] };
+}
 
+template <typename Curve>
+inline float shape_sample(float sample, const params& p, const stage_coefs& c) {
+	for (int j = 0; j < p.num_stages; j++) {
+		const int32_t mask = *(int32_t*)&sample >> 0x1f;
+		fp32_to_u32 coeff, norm;
+		coeff.u = (~mask & *(const uint32_t*)&c.coef_pos) | (mask & *(const uint32_t*)&c.coef_neg);
+		norm.u = (~mask & *(const uint32_t*)&c.norm_pos) | (mask & *(const uint32_t*)&c.norm_neg);
+		sample = norm.f * Curve::eval(coeff.f * sample);
+		const uint32_t inverted = *(uint32_t*)&sample ^ (0x80000000 & ~((p.invert_stages & j) - 0x01));
+		sample = *(float*)&inverted;
+	}
+	return sample * c.gain;
+}
 
-typedef union fp32_to_u32 {
-	float f;
-	uint32_t u;
-} fp32_to_u32;
+template <typename Curve>
+static void waveshaper_impl(float* in, const float* dry, float* out, int buf_len, const params p) {
+	const stage_coefs c = make_coefs<Curve>(p, 0);
+	const float mix_inc = (p.mix_end - p.mix_start) / (float)buf_len;
+	for (int i = 0; i < buf_len; i++) {
+		const float sample = shape_sample<Curve>(in[i], p, c);
+		const float mix = p.mix_start + mix_inc * (float)i;
+		out[i] = dry ? dry[i] + mix * (sample - dry[i]) : sample;
+	}
+}
 
-inline float fast_atan(float x) {
-	fp32_to_u32 f2u;
-	f2u.f = x;
-	f2u.u &= 0x7FFFFFFF;
-	return M_PI_4 * x - x * (f2u.f - 1.0f) * (0.2447f + 0.0663f * f2u.f);
+// vectors shaped side by side in the main loop so their serial stage chains overlap.
+// 8 was fastest on x64 across curves and quality levels (tried 1 - 8),
+// x86 only has 8 xmm registers so it is kept at 2 to avoid spilling.
+// Can be overridden from the build to retune for a specific CPU.
+#ifndef WAVESHAPER_INTERLEAVE
+#if defined(_M_X64) || defined(__x86_64__)
+#define WAVESHAPER_INTERLEAVE 8
+#else
+#define WAVESHAPER_INTERLEAVE 2
+#endif
+#endif
 
-	//const int abs_x_bits = *(uint32_t*)&x & 0x7FFFFFFF;
-	//const float abs_x = *(float*)&abs_x_bits;
-	//return M_PI_4 * x - x * (abs_x - 1.0f) * (0.2447f + 0.0663f * abs_x);
+// dry/wet amount of samples i ... i + 3. Computed from the index rather than accumulated,
+// so the vector body, the scalar tail and the scalar reference ramp through the same values
+inline __m128 mix_ramp(const __m128 mix_start, const __m128 mix_inc, int i) {
+	const __m128 index = _mm_add_ps(_mm_set1_ps((float)i), _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f));
+	return _mm_add_ps(mix_start, _mm_mul_ps(mix_inc, index));
 }
 
-#define fast_atan_simd(x) \
-abs_x = _mm_and_ps(x, *(__m128*)&not_sign_bit);\
-temp = _mm_sub_ps(abs_x, one);\
-temp = _mm_mul_ps(temp, x);\
-x = _mm_mul_ps(x, pi_4);\
-abs_x = _mm_mul_ps(abs_x, b);\
-abs_x = _mm_add_ps(abs_x, a);\
-temp = _mm_mul_ps(temp, abs_x);\
-x = _mm_sub_ps(x, temp);\
+struct simd_coefs {
+	__m128 c_pos, c_neg;
+	__m128 n_pos, n_neg;
+	__m128 gain;
+};
 
-void waveshaper(float* in, float* out, int buf_len, const params p) {
-	for (int i = 0; i < buf_len; i++) {
-		float sample = in[i];
+template <typename Curve>
+inline __m128 shape_stage(__m128 sample, const simd_coefs& c, const __m128 inv) {
+	const __m128 mask = _mm_castsi128_ps(_mm_srai_epi32(_mm_castps_si128(sample), 0x1f));
+	const __m128 coef = _mm_or_ps(_mm_and_ps(mask, c.c_neg), _mm_andnot_ps(mask, c.c_pos));
+	const __m128 norm = _mm_or_ps(_mm_and_ps(mask, c.n_neg), _mm_andnot_ps(mask, c.n_pos));
+	sample = _mm_mul_ps(Curve::eval(_mm_mul_ps(sample, coef)), norm);
+	return _mm_xor_ps(sample, inv);
+}
+
+// shapes groups of Depth vectors from i up to end, returns where it stopped
+template <typename Curve, bool Mix, int Depth>
+inline int shape_vectors(float* in, const float* dry, float* out, int i, int end, const params& p,
+						 const simd_coefs& c, const __m128 mix_start, const __m128 mix_step) {
+	for (; i + 4 * Depth <= end; i += 4 * Depth) {
+		__m128 sample[Depth];
+		for (int k = 0; k < Depth; k++)
+			sample[k] = _mm_load_ps(&in[i + 4 * k]);
 		for (int j = 0; j < p.num_stages; j++) {
-			const int32_t mask = *(int32_t*)&sample >> 0x1f;
-			fp32_to_u32 coeff;
-			coeff.u = (~mask & *(uint32_t*)&p.coef_pos) | (mask & *(uint32_t*)&p.coef_neg);
-			sample = (1.0f / fast_atan(coeff.f)) * fast_atan(coeff.f * sample);
-			const uint32_t inverted = *(uint32_t*)&sample ^ (0x80000000 & ~((p.invert_stages & j) - 0x01));
-			sample = *(float*)&inverted;
+			const uint32_t invert = 0x80000000 & ~((p.invert_stages & j) - 0x01);
+			const __m128 inv = _mm_castsi128_ps(_mm_set1_epi32(invert));
+			for (int k = 0; k < Depth; k++)
+				sample[k] = shape_stage<Curve>(sample[k], c, inv);
+		}
+		for (int k = 0; k < Depth; k++) {
+			sample[k] = _mm_mul_ps(sample[k], c.gain);
+			if (Mix) {
+				const __m128 d = _mm_loadu_ps(&dry[i + 4 * k]);
+				const __m128 mix = mix_ramp(mix_start, mix_step, i + 4 * k);
+				sample[k] = _mm_add_ps(d, _mm_mul_ps(mix, _mm_sub_ps(sample[k], d)));
+			}
+			_mm_store_ps(&out[i + 4 * k], sample[k]);
 		}
-		sample *= p.gain;
-		out[i] = sample;
 	}
+	return i;
 }
 
-void waveshaper_simd(float* in, float* out, int buf_len, const params p) {
+template <typename Curve, bool Mix>
+static void waveshaper_simd_impl(float* in, const float* dry, float* out, int buf_len, const params p) {
 	const int buf_len_simd = buf_len & ~0x03;
-	const __m128i not_sign_bit = _mm_set1_epi32(0x7FFFFFFF);
-	const __m128 c_pos = _mm_set1_ps(p.coef_pos);
-	const __m128 c_neg = _mm_set1_ps(p.coef_neg);
-	const __m128i not_mask = _mm_set1_epi32(0xFFFFFFFF);
-	const __m128 pi_4 = _mm_set1_ps(M_PI_4);
-	const __m128 one = _mm_set1_ps(1.0f);
-	const __m128 a = _mm_set1_ps(0.2447f);
-	const __m128 b = _mm_set1_ps(0.0663f);
-	const __m128 gain = _mm_set1_ps(p.gain);
+	const stage_coefs c = make_coefs<Curve>(p, 0);
+	const simd_coefs vc = { _mm_set1_ps(c.coef_pos), _mm_set1_ps(c.coef_neg),
+							_mm_set1_ps(c.norm_pos), _mm_set1_ps(c.norm_neg),
+							_mm_set1_ps(c.gain) };
+	// dry/wet ramps linearly over the block, one step per sample
+	const float mix_inc = (p.mix_end - p.mix_start) / (float)buf_len;
+	const __m128 mix_start = _mm_set1_ps(p.mix_start);
+	const __m128 mix_step = _mm_set1_ps(mix_inc);
 
 	// process
-	for (int i = 0; i < buf_len_simd; i += 4) {
-		__m128 sample = _mm_load_ps(&in[i]);
+	int i = shape_vectors<Curve, Mix, WAVESHAPER_INTERLEAVE>(in, dry, out, 0, buf_len_simd, p, vc, mix_start, mix_step);
+	shape_vectors<Curve, Mix, 1>(in, dry, out, i, buf_len_simd, p, vc, mix_start, mix_step);
+
+	// process the rest
+	for (int i = buf_len_simd; i < buf_len; i++) {
+		const float sample = shape_sample<Curve>(in[i], p, c);
+		const float mix = p.mix_start + mix_inc * (float)i;
+		out[i] = Mix ? dry[i] + mix * (sample - dry[i]) : sample;
+	}
+}
+
+// stereo frames are shaped interleaved as [a0 b0 a1 b1], a/b being L/R or M/S,
+// so both channels share one stage chain with their own coefficients in alternate lanes
+static constexpr int STEREO_INTERLEAVE = WAVESHAPER_INTERLEAVE > 1 ? WAVESHAPER_INTERLEAVE / 2 : 1;
+
+template <bool MidSide>
+inline void encode(__m128& a, __m128& b) {
+	if (MidSide) {
+		const __m128 half = _mm_set1_ps(0.5f);
+		const __m128 l = a;
+		a = _mm_mul_ps(_mm_add_ps(l, b), half);
+		b = _mm_mul_ps(_mm_sub_ps(l, b), half);
+	}
+}
+
+template <bool MidSide>
+inline void decode(__m128& a, __m128& b) {
+	if (MidSide) {
+		const __m128 m = a;
+		a = _mm_add_ps(m, b);
+		b = _mm_sub_ps(m, b);
+	}
+}
+
+// shapes groups of Depth * 4 frames from i up to end, returns where it stopped
+template <typename Curve, bool Mix, bool MidSide, int Depth>
+inline int shape_frames(float* const* in, const float* const* dry, float* const* out, int i, int end, const params& p,
+						const simd_coefs& c, const __m128 mix_start, const __m128 mix_step) {
+	for (; i + 4 * Depth <= end; i += 4 * Depth) {
+		__m128 sample[2 * Depth];
+		for (int k = 0; k < Depth; k++) {
+			__m128 a = _mm_load_ps(&in[0][i + 4 * k]);
+			__m128 b = _mm_load_ps(&in[1][i + 4 * k]);
+			encode<MidSide>(a, b);
+			sample[2 * k] = _mm_unpacklo_ps(a, b);
+			sample[2 * k + 1] = _mm_unpackhi_ps(a, b);
+		}
 		for (int j = 0; j < p.num_stages; j++) {
-			__m128i mask = _mm_srai_epi32(*(__m128i*) & sample, 0x1f);
-			__m128 coef = _mm_and_ps(*(__m128*) & mask, c_neg);
-			mask = _mm_xor_si128(mask, not_mask);
-			mask = _mm_and_si128(mask, *(__m128i*) & c_pos);
-			coef = _mm_or_ps(coef, *(__m128*) & mask);
-			sample = _mm_mul_ps(sample, coef);
-			__m128 abs_x, temp;
-			fast_atan_simd(coef);
-			coef = _mm_div_ps(one, coef);
-			fast_atan_simd(sample);
-			sample = _mm_mul_ps(sample, coef);
 			const uint32_t invert = 0x80000000 & ~((p.invert_stages & j) - 0x01);
-			const __m128i inv = _mm_set1_epi32(invert);
-			sample = _mm_xor_ps(sample, *(__m128*) & inv);
+			const __m128 inv = _mm_castsi128_ps(_mm_set1_epi32(invert));
+			for (int k = 0; k < 2 * Depth; k++)
+				sample[k] = shape_stage<Curve>(sample[k], c, inv);
+		}
+		for (int k = 0; k < Depth; k++) {
+			const __m128 lo = _mm_mul_ps(sample[2 * k], c.gain);
+			const __m128 hi = _mm_mul_ps(sample[2 * k + 1], c.gain);
+			__m128 a = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+			__m128 b = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1));
+			decode<MidSide>(a, b);
+			if (Mix) {
+				const __m128 da = _mm_loadu_ps(&dry[0][i + 4 * k]);
+				const __m128 db = _mm_loadu_ps(&dry[1][i + 4 * k]);
+				const __m128 mix = mix_ramp(mix_start, mix_step, i + 4 * k);
+				a = _mm_add_ps(da, _mm_mul_ps(mix, _mm_sub_ps(a, da)));
+				b = _mm_add_ps(db, _mm_mul_ps(mix, _mm_sub_ps(b, db)));
+			}
+			_mm_store_ps(&out[0][i + 4 * k], a);
+			_mm_store_ps(&out[1][i + 4 * k], b);
 		}
-		sample = _mm_mul_ps(sample, gain);
-		_mm_store_ps(&out[i], sample);
 	}
+	return i;
+}
+
+template <typename Curve, bool Mix, bool MidSide>
+static void waveshaper_stereo_simd_impl(float* const* in, const float* const* dry, float* const* out, int buf_len, const params p) {
+	const int buf_len_simd = buf_len & ~0x03;
+	const stage_coefs c0 = make_coefs<Curve>(p, 0);
+	const stage_coefs c1 = make_coefs<Curve>(p, 1);
+	const simd_coefs vc = { _mm_set_ps(c1.coef_pos, c0.coef_pos, c1.coef_pos, c0.coef_pos),
+							_mm_set_ps(c1.coef_neg, c0.coef_neg, c1.coef_neg, c0.coef_neg),
+							_mm_set_ps(c1.norm_pos, c0.norm_pos, c1.norm_pos, c0.norm_pos),
+							_mm_set_ps(c1.norm_neg, c0.norm_neg, c1.norm_neg, c0.norm_neg),
+							_mm_set_ps(c1.gain, c0.gain, c1.gain, c0.gain) };
+	// dry/wet ramps linearly over the block, one step per frame
+	const float mix_inc = (p.mix_end - p.mix_start) / (float)buf_len;
+	const __m128 mix_start = _mm_set1_ps(p.mix_start);
+	const __m128 mix_step = _mm_set1_ps(mix_inc);
+
+	// process
+	int i = shape_frames<Curve, Mix, MidSide, STEREO_INTERLEAVE>(in, dry, out, 0, buf_len_simd, p, vc, mix_start, mix_step);
+	shape_frames<Curve, Mix, MidSide, 1>(in, dry, out, i, buf_len_simd, p, vc, mix_start, mix_step);
 
 	// process the rest
 	for (int i = buf_len_simd; i < buf_len; i++) {
-		float sample = in[i];
-		for (int j = 0; j < p.num_stages; j++) {
-			const int32_t mask = *(int32_t*)&sample >> 0x1f;
-			fp32_to_u32 coeff;
-			coeff.u = (~mask & *(uint32_t*)&p.coef_pos) | (mask & *(uint32_t*)&p.coef_neg);
-			sample = (1.0f / fast_atan(coeff.f)) * fast_atan(coeff.f * sample);
-			const uint32_t inverted = *(uint32_t*)&sample ^ (0x80000000 & ~((p.invert_stages & j) - 0x01));
-			sample = *(float*)&inverted;
+		float a = in[0][i], b = in[1][i];
+		if (MidSide) {
+			const float l = a;
+			a = (l + b) * 0.5f;
+			b = (l - b) * 0.5f;
+		}
+		a = shape_sample<Curve>(a, p, c0);
+		b = shape_sample<Curve>(b, p, c1);
+		if (MidSide) {
+			const float m = a;
+			a = m + b;
+			b = m - b;
 		}
-		sample *= p.gain;
-		out[i] = sample;
+		const float mix = p.mix_start + mix_inc * (float)i;
+		out[0][i] = Mix ? dry[0][i] + mix * (a - dry[0][i]) : a;
+		out[1][i] = Mix ? dry[1][i] + mix * (b - dry[1][i]) : b;
+	}
+}
+
+template <template <bool> class Curve>
+static void dispatch(float* in, const float* dry, float* out, int buf_len, const params& p) {
+	if (p.precise)
+		waveshaper_impl<Curve<true>>(in, dry, out, buf_len, p);
+	else
+		waveshaper_impl<Curve<false>>(in, dry, out, buf_len, p);
+}
+
+template <template <bool> class Curve>
+static void dispatch_simd(float* in, const float* dry, float* out, int buf_len, const params& p) {
+	if (p.precise) {
+		if (dry)
+			waveshaper_simd_impl<Curve<true>, true>(in, dry, out, buf_len, p);
+		else
+			waveshaper_simd_impl<Curve<true>, false>(in, dry, out, buf_len, p);
+	} else {
+		if (dry)
+			waveshaper_simd_impl<Curve<false>, true>(in, dry, out, buf_len, p);
+		else
+			waveshaper_simd_impl<Curve<false>, false>(in, dry, out, buf_len, p);
+	}
+}
+
+template <typename Curve, bool Mix>
+static void dispatch_stereo_mode(float* const* in, const float* const* dry, float* const* out, int buf_len, const params& p) {
+	if (p.stereo_mode == Steinberg::DistConst::STEREO_MID_SIDE)
+		waveshaper_stereo_simd_impl<Curve, Mix, true>(in, dry, out, buf_len, p);
+	else
+		waveshaper_stereo_simd_impl<Curve, Mix, false>(in, dry, out, buf_len, p);
+}
+
+template <template <bool> class Curve>
+static void dispatch_stereo(float* const* in, const float* const* dry, float* const* out, int buf_len, const params& p) {
+	if (p.precise) {
+		if (dry)
+			dispatch_stereo_mode<Curve<true>, true>(in, dry, out, buf_len, p);
+		else
+			dispatch_stereo_mode<Curve<true>, false>(in, dry, out, buf_len, p);
+	} else {
+		if (dry)
+			dispatch_stereo_mode<Curve<false>, true>(in, dry, out, buf_len, p);
+		else
+			dispatch_stereo_mode<Curve<false>, false>(in, dry, out, buf_len, p);
 	}
-}
\ No newline at end of file
+}
+
+// scalar reference, dry may be null for the wet signal only
+void waveshaper(float* in, const float* dry, float* out, int buf_len, const params p) {
+	switch (p.curve) {
+	case Steinberg::DistConst::CURVE_TANH:	dispatch<tanh_curve>(in, dry, out, buf_len, p); break;
+	case Steinberg::DistConst::CURVE_CUBIC:	dispatch<cubic_curve>(in, dry, out, buf_len, p); break;
+	case Steinberg::DistConst::CURVE_HARD:	dispatch<hard_curve>(in, dry, out, buf_len, p); break;
+	case Steinberg::DistConst::CURVE_PADE:	dispatch<pade_curve>(in, dry, out, buf_len, p); break;
+	default:								dispatch<atan_curve>(in, dry, out, buf_len, p); break;
+	}
+}
+
+// dry may be null for the wet signal only
+void waveshaper_simd(float* in, const float* dry, float* out, int buf_len, const params p) {
+	switch (p.curve) {
+	case Steinberg::DistConst::CURVE_TANH:	dispatch_simd<tanh_curve>(in, dry, out, buf_len, p); break;
+	case Steinberg::DistConst::CURVE_CUBIC:	dispatch_simd<cubic_curve>(in, dry, out, buf_len, p); break;
+	case Steinberg::DistConst::CURVE_HARD:	dispatch_simd<hard_curve>(in, dry, out, buf_len, p); break;
+	case Steinberg::DistConst::CURVE_PADE:	dispatch_simd<pade_curve>(in, dry, out, buf_len, p); break;
+	default:								dispatch_simd<atan_curve>(in, dry, out, buf_len, p); break;
+	}
+}
+
+// both channels in one pass, channel 1 coefficients apply to R or S depending on p.stereo_mode.
+// dry may be null for the wet signal only
+void waveshaper_stereo_simd(float* const* in, const float* const* dry, float* const* out, int buf_len, const params p) {
+	switch (p.curve) {
+	case Steinberg::DistConst::CURVE_TANH:	dispatch_stereo<tanh_curve>(in, dry, out, buf_len, p); break;
+	case Steinberg::DistConst::CURVE_CUBIC:	dispatch_stereo<cubic_curve>(in, dry, out, buf_len, p); break;
+	case Steinberg::DistConst::CURVE_HARD:	dispatch_stereo<hard_curve>(in, dry, out, buf_len, p); break;
+	case Steinberg::DistConst::CURVE_PADE:	dispatch_stereo<pade_curve>(in, dry, out, buf_len, p); break;
+	default:								dispatch_stereo<atan_curve>(in, dry, out, buf_len, p); break;
+	}
+}
+
+// blends dry into the already shaped out, used when the kernel ran at a different rate than the dry signal
+void dry_wet_simd(const float* dry, float* out, int buf_len, const params p) {
+	const int buf_len_simd = buf_len & ~0x03;
+	const float mix_inc = (p.mix_end - p.mix_start) / (float)buf_len;
+	const __m128 mix_start = _mm_set1_ps(p.mix_start);
+	const __m128 mix_step = _mm_set1_ps(mix_inc);
+
+	for (int i = 0; i < buf_len_simd; i += 4) {
+		const __m128 d = _mm_loadu_ps(&dry[i]);
+		const __m128 sample = _mm_load_ps(&out[i]);
+		const __m128 mix = mix_ramp(mix_start, mix_step, i);
+		_mm_store_ps(&out[i], _mm_add_ps(d, _mm_mul_ps(mix, _mm_sub_ps(sample, d))));
+	}
+
+	for (int i = buf_len_simd; i < buf_len; i++) {
+		const float mix = p.mix_start + mix_inc * (float)i;
+		out[i] = dry[i] + mix * (out[i] - dry[i]);
+	}
+}